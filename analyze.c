@@ -0,0 +1,436 @@
+#define _POSIX_C_SOURCE 200809L // For getline, getopt and mmap
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "game.h"
+#include "eval.h"
+
+#define MAX_MOVES   (ROWS * COLS)
+#define BATCH_SIZE  4096 // Positions handed to the workers at a time
+#define CHUNK_SIZE  16   // Positions a worker claims per lock
+#define OUT_LEN     96
+
+/** One position read from the input together with its analysis */
+struct position_job {
+    int nmoves;
+    int malformed;
+    unsigned char moves[MAX_MOVES];
+    char out[OUT_LEN];
+};
+
+/** Source of positions: either a stream (stdin) or a memory-mapped file */
+struct position_reader {
+    FILE *fp;
+    char *line;
+    size_t line_cap;
+    const unsigned char *map;
+    size_t map_size;
+    size_t map_pos;
+    int binary;
+};
+
+/** Batch of jobs shared between the main thread and the workers */
+struct work_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    struct position_job *jobs;
+    size_t count;
+    size_t next;
+    size_t finished;
+    unsigned long generation;
+    int shutdown;
+};
+
+static struct work_queue queue;
+static int solve_max_empty = -1; // Solve positions with at most this many empty cells
+
+/** Convert a text move sequence ("4453...", columns 1-7) into a job
+ * @param job The job to fill
+ * @param text The move characters
+ * @param len The number of characters in text
+ */
+static void parse_text(struct position_job *job, const char *text, size_t len) {
+    job->nmoves = 0;
+    job->malformed = 0;
+    for (size_t i = 0; i < len; i++) {
+        char ch = text[i];
+        if (ch == '\r' || ch == '\n') continue;
+        if (ch < '1' || ch >= '1' + COLS || job->nmoves == MAX_MOVES) {
+            job->malformed = 1;
+            return;
+        }
+        job->moves[job->nmoves++] = (unsigned char)(ch - '1');
+    }
+}
+
+/** Convert a binary record (columns 0-6) into a job
+ * @param job The job to fill
+ * @param moves The move bytes
+ * @param len The number of moves in the record
+ */
+static void parse_binary(struct position_job *job, const unsigned char *moves, size_t len) {
+    job->nmoves = 0;
+    job->malformed = (len > MAX_MOVES);
+    for (size_t i = 0; i < len && !job->malformed; i++) {
+        if (moves[i] >= COLS) job->malformed = 1;
+        else job->moves[job->nmoves++] = moves[i];
+    }
+}
+
+/** Read the next position from the input
+ * Text records are one line each. Binary records are a length byte followed
+ * by that many column bytes.
+ * @param reader The input source
+ * @param job The job to fill
+ *
+ * @return 1 if a position was read, 0 at end of input
+ */
+static int read_position(struct position_reader *reader, struct position_job *job) {
+    if (reader->map != NULL) {
+        if (reader->map_pos >= reader->map_size) return 0;
+        const unsigned char *start = reader->map + reader->map_pos;
+        size_t left = reader->map_size - reader->map_pos;
+        if (reader->binary) {
+            size_t len = start[0];
+            if (len > left - 1) len = left - 1; // Truncated last record
+            parse_binary(job, start + 1, len);
+            if (len != start[0]) job->malformed = 1;
+            reader->map_pos += len + 1;
+        } else {
+            const unsigned char *end = memchr(start, '\n', left);
+            size_t len = end ? (size_t)(end - start) : left;
+            parse_text(job, (const char *)start, len);
+            reader->map_pos += len + 1;
+        }
+        return 1;
+    }
+
+    if (reader->binary) {
+        int len = fgetc(reader->fp);
+        if (len == EOF) return 0;
+        unsigned char buf[256];
+        size_t got = fread(buf, 1, (size_t)len, reader->fp);
+        parse_binary(job, buf, got);
+        if (got != (size_t)len) job->malformed = 1;
+        return 1;
+    }
+
+    ssize_t len = getline(&reader->line, &reader->line_cap, reader->fp);
+    if (len < 0) return 0;
+    parse_text(job, reader->line, (size_t)len);
+    return 1;
+}
+
+/** Score the position by negamax with alpha-beta pruning
+ * Scores follow the usual convention: positive if the side to move wins,
+ * larger the sooner it wins, 0 for a draw. Moves are explored in the order
+ * the static evaluator suggests.
+ * @param state The evaluation state of the board (restored before returning)
+ * @param player The player to move
+ * @param alpha The lower bound of the search window
+ * @param beta The upper bound of the search window
+ *
+ * @return The exact score if it lies within (alpha, beta), otherwise a bound
+ */
+static int solve(struct eval_state *state, unsigned char player, int alpha, int beta) {
+    if (state->moves == MAX_MOVES) return 0;
+
+    int moves[COLS];
+    int count = eval_order_moves(state, player, moves);
+
+    // Win right away if possible; a winning move is always ordered first
+    eval_play(state, moves[0], player);
+    int win = (state->winner == player);
+    eval_undo(state, moves[0]);
+    if (win) return (MAX_MOVES + 1 - state->moves) / 2;
+
+    // We cannot win before our next move, so bound the best possible score
+    int max = (MAX_MOVES - 1 - state->moves) / 2;
+    if (beta > max) {
+        beta = max;
+        if (alpha >= beta) return beta;
+    }
+
+    unsigned char opponent = (player == PLAYER_ONE) ? PLAYER_TWO : PLAYER_ONE;
+    for (int i = 0; i < count; i++) {
+        eval_play(state, moves[i], player);
+        int score = -solve(state, opponent, -beta, -alpha);
+        eval_undo(state, moves[i]);
+        if (score >= beta) return score;
+        if (score > alpha) alpha = score;
+    }
+    return alpha;
+}
+
+/** Append the 1-based columns in mask to the output, or "-" if there are none
+ * @param out The output buffer
+ * @param len The current length of the output
+ * @param mask Bit i set for column i
+ *
+ * @return The new length of the output
+ */
+static int append_columns(char *out, int len, unsigned mask) {
+    if (mask == 0) {
+        out[len++] = '-';
+    }
+    for (int col = 0; col < COLS; col++) {
+        if (mask & (1u << col)) out[len++] = (char)('1' + col);
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/** Replay a position and describe it: legal moves, immediate wins for the
+ * side to move, opponent threats that must be blocked, the static
+ * evaluation and optionally the solved score
+ * @param job The position to analyze; the result is written to job->out
+ */
+static void analyze_position(struct position_job *job) {
+    struct eval_state state;
+    eval_init(&state);
+    unsigned char *cells = state.cells;
+
+    if (job->malformed) {
+        snprintf(job->out, OUT_LEN, "invalid");
+        return;
+    }
+
+    // Replay the moves, rejecting full columns and moves after a win
+    unsigned char player = PLAYER_ONE;
+    for (int i = 0; i < job->nmoves; i++) {
+        if (state.winner != PLAYER_NONE || eval_play(&state, job->moves[i], player) == -1) {
+            snprintf(job->out, OUT_LEN, "invalid move=%d", i + 1);
+            return;
+        }
+        player = (player == PLAYER_ONE) ? PLAYER_TWO : PLAYER_ONE;
+    }
+    if (state.winner != PLAYER_NONE) {
+        snprintf(job->out, OUT_LEN, "over winner=%d", state.winner);
+        return;
+    }
+    if (is_board_full(cells)) {
+        snprintf(job->out, OUT_LEN, "over draw");
+        return;
+    }
+
+    // Find legal moves, our immediate wins and the opponent's threats
+    unsigned char opponent = (player == PLAYER_ONE) ? PLAYER_TWO : PLAYER_ONE;
+    unsigned legal = 0, wins = 0, threats = 0;
+    for (int col = 0; col < COLS; col++) {
+        int row = find_row(col, cells);
+        if (row == -1) continue;
+        legal |= 1u << col;
+        cells[row * COLS + col] = player;
+        if (check_win(cells, row, col, player)) wins |= 1u << col;
+        cells[row * COLS + col] = opponent;
+        if (check_win(cells, row, col, opponent)) threats |= 1u << col;
+        cells[row * COLS + col] = PLAYER_NONE;
+    }
+
+    int len = snprintf(job->out, OUT_LEN, "legal=");
+    len = append_columns(job->out, len, legal);
+    len += snprintf(job->out + len, OUT_LEN - len, " wins=");
+    len = append_columns(job->out, len, wins);
+    len += snprintf(job->out + len, OUT_LEN - len, " threats=");
+    len = append_columns(job->out, len, threats);
+    len += snprintf(job->out + len, OUT_LEN - len, " eval=%d", eval_score(&state, player));
+
+    if (solve_max_empty >= 0) {
+        if (MAX_MOVES - job->nmoves <= solve_max_empty) {
+            int score = solve(&state, player, -MAX_MOVES / 2, MAX_MOVES / 2);
+            snprintf(job->out + len, OUT_LEN - len, " score=%d", score);
+        } else {
+            snprintf(job->out + len, OUT_LEN - len, " score=?");
+        }
+    }
+}
+
+/** Thread function for the analysis workers
+ * Waits for a batch, claims positions from it in chunks until none are left,
+ * and signals the main thread once the whole batch is finished
+ * @param arg Thread argument (unused)
+ *
+ * @return NULL
+ */
+static void *worker_thread(void *arg) {
+    (void)arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&queue.mutex);
+    while (1) {
+        while (queue.generation == seen && !queue.shutdown) {
+            pthread_cond_wait(&queue.work_ready, &queue.mutex);
+        }
+        if (queue.shutdown) break;
+        seen = queue.generation;
+
+        while (queue.next < queue.count) {
+            size_t start = queue.next;
+            size_t end = start + CHUNK_SIZE;
+            if (end > queue.count) end = queue.count;
+            queue.next = end;
+            pthread_mutex_unlock(&queue.mutex);
+
+            for (size_t i = start; i < end; i++) analyze_position(&queue.jobs[i]);
+
+            pthread_mutex_lock(&queue.mutex);
+            queue.finished += end - start;
+            if (queue.finished == queue.count) pthread_cond_signal(&queue.work_done);
+        }
+    }
+    pthread_mutex_unlock(&queue.mutex);
+    return NULL;
+}
+
+/** Fill a batch from the input
+ * @param reader The input source
+ * @param jobs The batch to fill
+ *
+ * @return The number of positions read
+ */
+static size_t fill_batch(struct position_reader *reader, struct position_job *jobs) {
+    size_t count = 0;
+    while (count < BATCH_SIZE && read_position(reader, &jobs[count])) count++;
+    return count;
+}
+
+/** Main entry point for the position analyzer
+ * @param argc Number of command line arguments
+ * @param argv Command line arguments
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int main(int argc, char **argv) {
+    struct position_reader reader = { .fp = stdin };
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // Argument parsing
+    int opt;
+    while ((opt = getopt(argc, argv, "bs:j:")) != -1) {
+        switch (opt) {
+        case 'b': reader.binary = 1; break;
+        case 's': solve_max_empty = atoi(optarg); break;
+        case 'j': threads = atol(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b] [-s max-empty] [-j threads] [file]\n"
+                            "  -b  Binary input: length byte followed by columns 0-6\n"
+                            "  -s  Solve positions with at most max-empty empty cells\n"
+                            "  -j  Number of worker threads (default: all cores)\n"
+                            "Text input is one position per line as columns 1-7.\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    // Map the input file if one was given, otherwise stream stdin
+    int fd = -1;
+    if (optind < argc) {
+        fd = open(argv[optind], O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            return EXIT_FAILURE;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        reader.map_size = (size_t)st.st_size;
+        if (reader.map_size > 0) {
+            void *map = mmap(NULL, reader.map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                perror("mmap");
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            posix_madvise(map, reader.map_size, POSIX_MADV_SEQUENTIAL);
+            reader.map = map;
+        } else {
+            reader.map = (const unsigned char *)"";
+        }
+    }
+
+    // Two batches: the workers analyze one while we read the next
+    struct position_job *batches[2];
+    batches[0] = malloc(BATCH_SIZE * sizeof(struct position_job));
+    batches[1] = malloc(BATCH_SIZE * sizeof(struct position_job));
+    if (batches[0] == NULL || batches[1] == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    // Start the workers
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.work_ready, NULL);
+    pthread_cond_init(&queue.work_done, NULL);
+    pthread_t *workers = malloc((size_t)threads * sizeof(pthread_t));
+    if (workers == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    for (long i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, worker_thread, NULL) != 0) {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t index = 0;
+    int cur = 0;
+    size_t count = fill_batch(&reader, batches[cur]);
+    while (count > 0) {
+        // Hand the batch to the workers
+        pthread_mutex_lock(&queue.mutex);
+        queue.jobs = batches[cur];
+        queue.count = count;
+        queue.next = 0;
+        queue.finished = 0;
+        queue.generation++;
+        pthread_cond_broadcast(&queue.work_ready);
+        pthread_mutex_unlock(&queue.mutex);
+
+        size_t next_count = fill_batch(&reader, batches[!cur]);
+
+        // Wait for the batch and print it in input order
+        pthread_mutex_lock(&queue.mutex);
+        while (queue.finished < queue.count) {
+            pthread_cond_wait(&queue.work_done, &queue.mutex);
+        }
+        pthread_mutex_unlock(&queue.mutex);
+
+        for (size_t i = 0; i < count; i++) {
+            printf("%zu %s\n", ++index, batches[cur][i].out);
+        }
+        fflush(stdout);
+
+        cur = !cur;
+        count = next_count;
+    }
+
+    // Shut down the workers
+    pthread_mutex_lock(&queue.mutex);
+    queue.shutdown = 1;
+    pthread_cond_broadcast(&queue.work_ready);
+    pthread_mutex_unlock(&queue.mutex);
+    for (long i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+
+    pthread_cond_destroy(&queue.work_done);
+    pthread_cond_destroy(&queue.work_ready);
+    pthread_mutex_destroy(&queue.mutex);
+    free(workers);
+    free(batches[0]);
+    free(batches[1]);
+    free(reader.line);
+    if (reader.map != NULL && reader.map_size > 0) munmap((void *)reader.map, reader.map_size);
+    if (fd != -1) close(fd);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "eval.h"
+
+#define WINDOWS_PER_CELL  16 // Upper bound on the windows through one cell
+
+#define THREE_WEIGHT      4  // Value of each open three
+#define PARITY_WEIGHT     4  // Extra value of an open three on the player's good rows
+#define CENTER_WEIGHT     1  // Value of each center weight point
+
+// Distance-from-edge weights used for center control
+static const int column_weight[COLS] = {0, 1, 2, 3, 2, 1, 0};
+
+// Cells making up each window, and the windows passing through each cell
+static int window_cells[EVAL_WINDOWS][4];
+static int cell_windows[ROWS * COLS][WINDOWS_PER_CELL];
+static int cell_window_count[ROWS * COLS];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/** Add a window of four cells starting at (row, col) to the tables
+ * @param window The index of the window
+ * @param row The row index of the first cell
+ * @param col The column index of the first cell
+ * @param row_step The row direction step (1 or 0)
+ * @param col_step The column direction step (1, -1, or 0)
+ */
+static void add_window(int window, int row, int col, int row_step, int col_step) {
+    for (int i = 0; i < 4; i++) {
+        int cell = (row + i * row_step) * COLS + (col + i * col_step);
+        window_cells[window][i] = cell;
+        cell_windows[cell][cell_window_count[cell]++] = window;
+    }
+}
+
+/** Build the window tables (called once through pthread_once) */
+static void build_tables(void) {
+    int window = 0;
+    for (int row = 0; row < ROWS; row++) {
+        for (int col = 0; col < COLS; col++) {
+            if (col + 3 < COLS) add_window(window++, row, col, 0, 1);
+            if (row + 3 < ROWS) add_window(window++, row, col, 1, 0);
+            if (row + 3 < ROWS && col + 3 < COLS) add_window(window++, row, col, 1, 1);
+            if (row + 3 < ROWS && col - 3 >= 0) add_window(window++, row, col, 1, -1);
+        }
+    }
+}
+
+/** Find which row the top token in a column is in
+ * @param col The column index
+ * @param cells The game board cells
+ *
+ * @return The row index of the top token, or -1 if the column is empty
+ */
+static int top_row(int col, const unsigned char *cells) {
+    for (int row = 0; row < ROWS; row++) {
+        if (cells[row * COLS + col] != PLAYER_NONE) return row;
+    }
+    return -1;
+}
+
+/** Add or remove a window's contribution to the threat counts
+ * A window counts when one player has three tokens in it and the fourth cell
+ * is empty. The empty cell's row decides the threat's parity.
+ * @param state The evaluation state
+ * @param window The index of the window
+ * @param sign 1 to add the contribution, -1 to remove it
+ */
+static void count_window(struct eval_state *state, int window, int sign) {
+    const unsigned char *counts = state->counts[window];
+    unsigned char player;
+    if (counts[PLAYER_ONE] == 3 && counts[PLAYER_TWO] == 0) player = PLAYER_ONE;
+    else if (counts[PLAYER_TWO] == 3 && counts[PLAYER_ONE] == 0) player = PLAYER_TWO;
+    else return;
+
+    for (int i = 0; i < 4; i++) {
+        int cell = window_cells[window][i];
+        if (state->cells[cell] != PLAYER_NONE) continue;
+        // Rows are counted from the bottom, starting at 1
+        if ((ROWS - cell / COLS) % 2 == 1) state->odd_threats[player] += sign;
+        else state->even_threats[player] += sign;
+        break;
+    }
+    state->open_threes[player] += sign;
+}
+
+/** Start evaluating an empty board
+ * @param state The evaluation state to reset
+ */
+void eval_init(struct eval_state *state) {
+    pthread_once(&tables_once, build_tables);
+    memset(state, 0, sizeof(*state));
+}
+
+/** Drop a token into a column and update the features
+ * Only the windows through the new token are revisited.
+ * @param state The evaluation state
+ * @param col The column index where the token is being dropped
+ * @param player The player dropping the token
+ *
+ * @return The row index where the token landed, or -1 if the column is full
+ */
+int eval_play(struct eval_state *state, int col, unsigned char player) {
+    int row = find_row(col, state->cells);
+    if (row == -1) return -1;
+    int cell = row * COLS + col;
+
+    for (int i = 0; i < cell_window_count[cell]; i++) {
+        count_window(state, cell_windows[cell][i], -1);
+    }
+    state->cells[cell] = player;
+    for (int i = 0; i < cell_window_count[cell]; i++) {
+        int window = cell_windows[cell][i];
+        if (++state->counts[window][player] == 4) state->winner = player;
+        count_window(state, window, 1);
+    }
+
+    state->center[player] += column_weight[col];
+    state->moves++;
+    return row;
+}
+
+/** Take back the top token in a column
+ * @param state The evaluation state
+ * @param col The column index of the token to remove
+ */
+void eval_undo(struct eval_state *state, int col) {
+    int row = top_row(col, state->cells);
+    if (row == -1) return;
+    int cell = row * COLS + col;
+    unsigned char player = state->cells[cell];
+
+    for (int i = 0; i < cell_window_count[cell]; i++) {
+        count_window(state, cell_windows[cell][i], -1);
+    }
+    state->cells[cell] = PLAYER_NONE;
+    for (int i = 0; i < cell_window_count[cell]; i++) {
+        int window = cell_windows[cell][i];
+        state->counts[window][player]--;
+        count_window(state, window, 1);
+    }
+
+    // Moves are never played after a win, so the removed token was the winner
+    state->winner = PLAYER_NONE;
+    state->center[player] -= column_weight[col];
+    state->moves--;
+}
+
+/** Score one player's features
+ * Player one wants threats on odd rows and player two on even rows, since
+ * those are the threats zugzwang lets each of them cash in at the end.
+ * @param state The evaluation state
+ * @param player The player to score
+ *
+ * @return The player's feature score
+ */
+static int player_score(const struct eval_state *state, unsigned char player) {
+    int good_threats = (player == PLAYER_ONE) ? state->odd_threats[player]
+                                              : state->even_threats[player];
+    return THREE_WEIGHT * state->open_threes[player]
+         + PARITY_WEIGHT * good_threats
+         + CENTER_WEIGHT * state->center[player];
+}
+
+/** Score the board from a player's point of view
+ * @param state The evaluation state
+ * @param player The player to score for
+ *
+ * @return Higher is better for player, 0 for an even position
+ */
+int eval_score(const struct eval_state *state, unsigned char player) {
+    unsigned char opponent = (player == PLAYER_ONE) ? PLAYER_TWO : PLAYER_ONE;
+    return player_score(state, player) - player_score(state, opponent);
+}
+
+/** List the legal columns for a player, most promising first
+ * Winning moves come first, then moves by their static evaluation. Ties keep
+ * center columns first.
+ * @param state The evaluation state (restored before returning)
+ * @param player The player to move
+ * @param moves Filled with up to COLS columns
+ *
+ * @return The number of legal columns
+ */
+int eval_order_moves(struct eval_state *state, unsigned char player, int *moves) {
+    static const int center_order[COLS] = {3, 2, 4, 1, 5, 0, 6};
+    int scores[COLS];
+    int count = 0;
+
+    for (int i = 0; i < COLS; i++) {
+        int col = center_order[i];
+        if (eval_play(state, col, player) == -1) continue;
+        int score = (state->winner == player) ? 1 << 20 : eval_score(state, player);
+        eval_undo(state, col);
+
+        // Insertion sort, best first
+        int j = count++;
+        while (j > 0 && scores[j - 1] < score) {
+            scores[j] = scores[j - 1];
+            moves[j] = moves[j - 1];
+            j--;
+        }
+        scores[j] = score;
+        moves[j] = col;
+    }
+    return count;
+}
+
+/** Pick a move for a cheap bot
+ * @param state The evaluation state (restored before returning)
+ * @param player The player to move
+ *
+ * @return The chosen column, or -1 if the board is full
+ */
+int eval_easy_move(struct eval_state *state, unsigned char player) {
+    unsigned char opponent = (player == PLAYER_ONE) ? PLAYER_TWO : PLAYER_ONE;
+    int moves[COLS];
+    int count = eval_order_moves(state, player, moves);
+    if (count == 0) return -1;
+
+    // Take a win; the ordering puts it first
+    if (eval_play(state, moves[0], player) != -1) {
+        int win = (state->winner == player);
+        eval_undo(state, moves[0]);
+        if (win) return moves[0];
+    }
+
+    // Block a column the opponent would win in
+    for (int i = 0; i < count; i++) {
+        eval_play(state, moves[i], opponent);
+        int threat = (state->winner == opponent);
+        eval_undo(state, moves[i]);
+        if (threat) return moves[i];
+    }
+
+    // Avoid giving the opponent a win on top of our token
+    for (int i = 0; i < count; i++) {
+        int col = moves[i];
+        eval_play(state, col, player);
+        int gives_win = 0;
+        if (eval_play(state, col, opponent) != -1) {
+            gives_win = (state->winner == opponent);
+            eval_undo(state, col);
+        }
+        eval_undo(state, col);
+        if (!gives_win) return col;
+    }
+    return moves[0];
+}
@@ -0,0 +1,43 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "game.h"
+
+// Number of lines of four cells on the board
+#define EVAL_WINDOWS ((ROWS * (COLS - 3)) + ((ROWS - 3) * COLS) + 2 * ((ROWS - 3) * (COLS - 3)))
+
+// Board features kept up to date as moves are played and undone
+struct eval_state {
+    unsigned char cells[ROWS * COLS];
+    unsigned char counts[EVAL_WINDOWS][3]; // Tokens of each player in each window
+    int open_threes[3];  // Windows with three of a player's tokens and one empty cell
+    int odd_threats[3];  // Open threes whose empty cell is on an odd row (from the bottom)
+    int even_threats[3]; // Open threes whose empty cell is on an even row
+    int center[3];       // Tokens weighted by how close they are to the center column
+    int moves;
+    unsigned char winner;
+};
+
+// Start evaluating an empty board
+void eval_init(struct eval_state *state);
+
+// Drop a token for player into col and update the features
+// Returns the row the token landed in, or -1 if the column is full
+int eval_play(struct eval_state *state, int col, unsigned char player);
+
+// Take back the top token in col
+void eval_undo(struct eval_state *state, int col);
+
+// Score the board from player's point of view, higher is better for player
+int eval_score(const struct eval_state *state, unsigned char player);
+
+// Fill moves with the legal columns for player, most promising first
+// Returns the number of legal columns
+int eval_order_moves(struct eval_state *state, unsigned char player, int *moves);
+
+// Pick a move for a cheap bot: win if possible, otherwise block, otherwise
+// the best column by the static evaluation
+// Returns the chosen column, or -1 if the board is full
+int eval_easy_move(struct eval_state *state, unsigned char player);
+
+#endif
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L // For getaddrinfo and clock_gettime
 #define _XOPEN_SOURCE_EXTENDED 1 // For emoji support
 #include <ncurses.h>
 #include <stdlib.h>
@@ -191,6 +192,11 @@ int main(int argc, char **argv) {
         socket_fd = fd;
     }
 
+    // Moves are tiny, so send each one as soon as it is written
+    if (socket_set_nodelay(socket_fd) == -1) {
+        perror("setsockopt");
+    }
+
     // Init UI 
     setlocale(LC_ALL, "");
     if (initscr() == NULL) {
@@ -2,48 +2,292 @@
 #define SOCKET_H
 
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOCKET_CONNECT_TIMEOUT_MS 5000  // Give up on connecting after this long
+#define SOCKET_ATTEMPT_DELAY_MS   250   // Wait before racing the next address
+#define SOCKET_CACHE_TTL_MS       60000 // How long a resolved host is reused
+#define SOCKET_CACHE_SIZE         8     // Number of hosts remembered
+#define SOCKET_MAX_ADDRS          8     // Addresses remembered per host
+#define SOCKET_MAX_HOST           256
+
+// A host name and the addresses getaddrinfo returned for it
+struct resolver_entry {
+  char host[SOCKET_MAX_HOST];
+  long long expires_ms;
+  int naddrs;
+  struct sockaddr_storage addrs[SOCKET_MAX_ADDRS];
+  socklen_t addrlens[SOCKET_MAX_ADDRS];
+};
+
+// Recently resolved hosts, shared by every thread that connects
+static struct resolver_entry resolver_cache[SOCKET_CACHE_SIZE];
+static pthread_mutex_t resolver_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Read a monotonic clock.
+ *
+ * \returns   The current time in milliseconds.
+ */
+static long long socket_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Look up the addresses of a server, using the cache when possible.
+ *
+ * Addresses are returned with the families interleaved (e.g. IPv6, IPv4, IPv6)
+ * starting with the family getaddrinfo preferred, so that a connection attempt
+ * can race the two families.
+ *
+ * \param server_name   A null-terminated string that specifies either the IP
+ *                      address or host name of the server.
+ * \param entry         Filled in with the server's addresses.
+ *
+ * \returns   0 on success, or -1 if the name could not be resolved. In that
+ *            case errno is set to EHOSTDOWN.
+ */
+static int socket_resolve(const char* server_name, struct resolver_entry* entry) {
+  long long now = socket_now_ms();
+
+  // Check the cache first
+  pthread_mutex_lock(&resolver_lock);
+  for (int i = 0; i < SOCKET_CACHE_SIZE; i++) {
+    if (resolver_cache[i].naddrs > 0 && resolver_cache[i].expires_ms > now &&
+        strcmp(resolver_cache[i].host, server_name) == 0) {
+      *entry = resolver_cache[i];
+      pthread_mutex_unlock(&resolver_lock);
+      return 0;
+    }
+  }
+  pthread_mutex_unlock(&resolver_lock);
+
+  // Look up the server by name. getaddrinfo is reentrant, so lookups from
+  // several threads do not block each other.
+  struct addrinfo hints = {
+      .ai_family = AF_UNSPEC,       // Accept both IPv4 and IPv6 addresses
+      .ai_socktype = SOCK_STREAM,   // We want TCP connections
+      .ai_flags = AI_ADDRCONFIG     // Only families this machine can use
+  };
+  struct addrinfo* result;
+  if (getaddrinfo(server_name, NULL, &hints, &result) != 0) {
+    // Set errno, since getaddrinfo reports errors in its return value
+    errno = EHOSTDOWN;
+    return -1;
+  }
+
+  // Split the addresses by family, keeping getaddrinfo's order within each
+  struct addrinfo* by_family[2][SOCKET_MAX_ADDRS];
+  int counts[2] = {0, 0};
+  for (struct addrinfo* ai = result; ai != NULL; ai = ai->ai_next) {
+    int other = (ai->ai_family != result->ai_family);
+    if (ai->ai_addrlen <= sizeof(struct sockaddr_storage) && counts[other] < SOCKET_MAX_ADDRS) {
+      by_family[other][counts[other]++] = ai;
+    }
+  }
+
+  // Interleave the families, starting with the one getaddrinfo preferred
+  memset(entry, 0, sizeof(*entry));
+  for (int i = 0; i < SOCKET_MAX_ADDRS; i++) {
+    for (int family = 0; family < 2; family++) {
+      if (i >= counts[family] || entry->naddrs == SOCKET_MAX_ADDRS) continue;
+      struct addrinfo* ai = by_family[family][i];
+      memcpy(&entry->addrs[entry->naddrs], ai->ai_addr, ai->ai_addrlen);
+      entry->addrlens[entry->naddrs] = ai->ai_addrlen;
+      entry->naddrs++;
+    }
+  }
+  freeaddrinfo(result);
+
+  if (entry->naddrs == 0) {
+    errno = EHOSTDOWN;
+    return -1;
+  }
+
+  // Remember the result, replacing an expired or the oldest entry
+  if (strlen(server_name) < SOCKET_MAX_HOST) {
+    strcpy(entry->host, server_name);
+    entry->expires_ms = now + SOCKET_CACHE_TTL_MS;
+
+    pthread_mutex_lock(&resolver_lock);
+    int slot = 0;
+    for (int i = 0; i < SOCKET_CACHE_SIZE; i++) {
+      if (strcmp(resolver_cache[i].host, server_name) == 0) {
+        slot = i;
+        break;
+      }
+      if (resolver_cache[i].expires_ms < resolver_cache[slot].expires_ms) slot = i;
+    }
+    resolver_cache[slot] = *entry;
+    pthread_mutex_unlock(&resolver_lock);
+  }
+
+  return 0;
+}
+
+/**
+ * Start a non-blocking connection attempt.
+ *
+ * \param addr      The address to connect to.
+ * \param addrlen   The length of addr.
+ * \param fd        Set to the socket for the attempt.
+ *
+ * \returns   1 if the connection completed immediately, 0 if it is in
+ *            progress, or -1 if there is an error. The errno value will be set
+ *            by the failed POSIX call.
+ */
+static int socket_connect_start(const struct sockaddr_storage* addr, socklen_t addrlen,
+                                int* fd) {
+  *fd = socket(addr->ss_family, SOCK_STREAM, 0);
+  if (*fd == -1) {
+    return -1;
+  }
+
+  // Make the socket non-blocking so connect returns right away
+  int flags = fcntl(*fd, F_GETFL);
+  if (flags == -1 || fcntl(*fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    int saved = errno;
+    close(*fd);
+    errno = saved;
+    return -1;
+  }
+
+  if (connect(*fd, (const struct sockaddr*)addr, addrlen) == 0) {
+    return 1;
+  }
+  if (errno == EINPROGRESS) {
+    return 0;
+  }
+
+  int saved = errno;
+  close(*fd);
+  errno = saved;
+  return -1;
+}
 
 /**
  * Create a new socket and connect to a server.
  *
+ * All of the server's addresses (IPv4 and IPv6) are tried. A new attempt is
+ * started every SOCKET_ATTEMPT_DELAY_MS while earlier ones are still pending,
+ * and the first one to connect is used.
+ *
  * \param server_name   A null-terminated string that specifies either the IP
  *                      address or host name of the server to connect to.
  * \param port          The port number the server should be listening on.
  *
  * \returns   A file descriptor for the connected socket, or -1 if there is an
- *            error. The errno value will be set by the failed POSIX call.
+ *            error. The errno value will be set by the failed POSIX call, or
+ *            to ETIMEDOUT if no address connected within
+ *            SOCKET_CONNECT_TIMEOUT_MS.
  */
 static int socket_connect(char* server_name, unsigned short port) {
-  // Look up the server by name
-  struct hostent* server = gethostbyname(server_name);
-  if (server == NULL) {
-    // Set errno, since gethostbyname does not
-    errno = EHOSTDOWN;
+  struct resolver_entry entry;
+  if (socket_resolve(server_name, &entry) == -1) {
     return -1;
   }
 
-  // Open a socket
-  int fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (fd == -1) {
-    return -1;
+  // Set the port on every address
+  for (int i = 0; i < entry.naddrs; i++) {
+    if (entry.addrs[i].ss_family == AF_INET6) {
+      ((struct sockaddr_in6*)&entry.addrs[i])->sin6_port = htons(port);
+    } else {
+      ((struct sockaddr_in*)&entry.addrs[i])->sin_port = htons(port);
+    }
   }
 
-  // Set up an address
-  struct sockaddr_in addr = {
-      .sin_family = AF_INET,   // This is an internet socket
-      .sin_port = htons(port)  // Connect to the appropriate port number
-  };
+  struct pollfd pending[SOCKET_MAX_ADDRS];
+  int npending = 0;
+  int next = 0;
+  int fd = -1;
+  int last_error = ECONNREFUSED;
+  long long now = socket_now_ms();
+  long long deadline = now + SOCKET_CONNECT_TIMEOUT_MS;
+  long long next_attempt = now;
+
+  while (fd == -1) {
+    now = socket_now_ms();
+
+    // Start the next attempt if nothing is pending or the last one is slow
+    if (next < entry.naddrs && (npending == 0 || now >= next_attempt)) {
+      int attempt_fd;
+      int rc = socket_connect_start(&entry.addrs[next], entry.addrlens[next], &attempt_fd);
+      next++;
+      if (rc == 1) {
+        fd = attempt_fd;
+      } else if (rc == 0) {
+        pending[npending].fd = attempt_fd;
+        pending[npending].events = POLLOUT;
+        npending++;
+        next_attempt = now + SOCKET_ATTEMPT_DELAY_MS;
+      } else {
+        last_error = errno;
+      }
+      continue;
+    }
+
+    // Every address failed
+    if (npending == 0) {
+      errno = last_error;
+      return -1;
+    }
 
-  // Copy the server address info returned by gethostbyname into the address
-  memcpy(&addr.sin_addr.s_addr, server->h_addr, server->h_length);
+    if (now >= deadline) {
+      for (int i = 0; i < npending; i++) close(pending[i].fd);
+      errno = ETIMEDOUT;
+      return -1;
+    }
 
-  // Connect to the server
-  if (connect(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in))) {
+    // Wait for an attempt to finish or for the time to start another one
+    long long wait = deadline - now;
+    if (next < entry.naddrs && next_attempt - now < wait) wait = next_attempt - now;
+    if (poll(pending, npending, (int)wait) == -1) {
+      if (errno == EINTR) continue;
+      last_error = errno;
+      for (int i = 0; i < npending; i++) close(pending[i].fd);
+      errno = last_error;
+      return -1;
+    }
+
+    // Check which attempts finished, keeping the first success
+    for (int i = 0; i < npending; i++) {
+      if (pending[i].revents == 0) continue;
+      int error = 0;
+      socklen_t len = sizeof(error);
+      if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        error = errno;
+      }
+      if (error == 0 && fd == -1) {
+        fd = pending[i].fd;
+      } else {
+        if (error != 0) last_error = error;
+        close(pending[i].fd);
+      }
+      pending[i--] = pending[--npending];
+    }
+  }
+
+  // Give up on the other attempts
+  for (int i = 0; i < npending; i++) close(pending[i].fd);
+
+  // Callers expect a blocking socket
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+    int saved = errno;
     close(fd);
+    errno = saved;
     return -1;
   }
 
@@ -53,6 +297,9 @@ static int socket_connect(char* server_name, unsigned short port) {
 /**
  * Open a server socket that will accept TCP connections from any other machine.
  *
+ * The socket accepts both IPv6 and IPv4 connections when the system supports
+ * IPv6, and only IPv4 connections otherwise.
+ *
  * \param port    A pointer to a port value. If *port is greater than zero, this
  *                function will attempt to open a server socket using that port.
  *                If *port is zero, the OS will choose. Regardless of the method
@@ -64,27 +311,50 @@ static int socket_connect(char* server_name, unsigned short port) {
  *                errno will be set by the POSIX socket function that failed.
  */
 static int server_socket_open(unsigned short* port) {
-  // Create a server socket. Return if there is an error.
-  int fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (fd == -1) {
+  struct sockaddr_storage addr;
+  memset(&addr, 0, sizeof(addr));
+  socklen_t addrlen;
+
+  // Create a server socket, preferring IPv6 so both families can connect
+  int fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if (fd != -1) {
+    // Accept IPv4 connections as well (as IPv4-mapped addresses)
+    int v6only = 0;
+    if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only))) {
+      close(fd);
+      return -1;
+    }
+
+    // Listen for connections from any client on the specified port
+    struct sockaddr_in6* addr6 = (struct sockaddr_in6*)&addr;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_addr = in6addr_any;
+    addr6->sin6_port = htons(*port);
+    addrlen = sizeof(struct sockaddr_in6);
+  } else if (errno == EAFNOSUPPORT) {
+    // No IPv6 on this system, so fall back to IPv4 only
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+      return -1;
+    }
+
+    struct sockaddr_in* addr4 = (struct sockaddr_in*)&addr;
+    addr4->sin_family = AF_INET;
+    addr4->sin_addr.s_addr = INADDR_ANY;
+    addr4->sin_port = htons(*port);
+    addrlen = sizeof(struct sockaddr_in);
+  } else {
     return -1;
   }
 
-  // Set up the server socket to listen
-  struct sockaddr_in addr = {
-      .sin_family = AF_INET,          // This is an internet socket
-      .sin_addr.s_addr = INADDR_ANY,  // Listen for connections from any client
-      .sin_port = htons(*port)        // Use the specified port (may be zero)
-  };
-
   // Bind the server socket to the address. Return if there is an error.
-  if (bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in))) {
+  if (bind(fd, (struct sockaddr*)&addr, addrlen)) {
     close(fd);
     return -1;
   }
 
   // Get information about the new socket
-  socklen_t addrlen = sizeof(struct sockaddr_in);
+  addrlen = sizeof(addr);
   if (getsockname(fd, (struct sockaddr*)&addr, &addrlen)) {
     close(fd);
     return -1;
@@ -92,10 +362,30 @@ static int server_socket_open(unsigned short* port) {
 
   // Read out the port information for the socket. If *port was zero, the OS
   // will select a port for us. This tells the caller which port was chosen.
-  *port = ntohs(addr.sin_port);
+  if (addr.ss_family == AF_INET6) {
+    *port = ntohs(((struct sockaddr_in6*)&addr)->sin6_port);
+  } else {
+    *port = ntohs(((struct sockaddr_in*)&addr)->sin_port);
+  }
 
   // Return the server socket file descriptor
   return fd;
 }
 
+/**
+ * Send small writes on a connected socket immediately.
+ *
+ * Moves are only a couple of bytes, so without this Nagle's algorithm can hold
+ * a move back until the previous one has been acknowledged.
+ *
+ * \param fd   A connected TCP socket.
+ *
+ * \returns   0 on success, or -1 if there is an error. The errno value will be
+ *            set by setsockopt.
+ */
+static int socket_set_nodelay(int fd) {
+  int enable = 1;
+  return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
 #endif